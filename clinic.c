@@ -1,7 +1,13 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
 
 #include "core.h"
 #include "clinic.h"
@@ -23,13 +29,13 @@ void displayPatientData(const struct Patient* patient, int fmt) {
             "Number: %05d\n"
             "Phone : ", patient->name, patient->patientNumber);
         displayFormattedPhone(patient->phone.number);
-        printf(" (%s)\n", patient->phone.description);
+        printf(" (%s)\n", phoneDescription(patient->phone.description));
     }
     else {
         printf("%05d %-15s ", patient->patientNumber,
             patient->name);
         displayFormattedPhone(patient->phone.number);
-        printf(" (%s)\n", patient->phone.description);
+        printf(" (%s)\n", phoneDescription(patient->phone.description));
     }
 }
 
@@ -57,7 +63,7 @@ void displayScheduleData(const struct Patient* patient,
     printf("%02d:%02d %05d %-15s ", appoint->time.hour, appoint->time.min,
         patient->patientNumber, patient->name);
     displayFormattedPhone(patient->phone.number);
-    printf(" (%s)\n", patient->phone.description);
+    printf(" (%s)\n", phoneDescription(patient->phone.description));
 }
 
 //////////////////////////////////////
@@ -72,11 +78,13 @@ void menuMain(struct ClinicData* data) {
             "=========================\n"
             "1) PATIENT     Management\n"
             "2) APPOINTMENT Management\n"
+            "3) UNDO        Last change\n"
+            "4) REDO        Last change\n"
             "-------------------------\n"
             "0) Exit System\n"
             "-------------------------\n"
             "Selection: ");
-        selection = inputIntRange(0, 2);
+        selection = inputIntRange(0, 4);
         putchar('\n');
         switch (selection) {
         case 0:
@@ -86,17 +94,25 @@ void menuMain(struct ClinicData* data) {
             if (!selection) printf("Exiting system... Goodbye.\n\n");
             break;
         case 1:
-            menuPatient(data->patients, data->maxPatient);
+            menuPatient(data);
             break;
         case 2:
             menuAppointment(data);
             break;
+        case 3:
+            undoChange(data);
+            break;
+        case 4:
+            redoChange(data);
+            break;
         }
     } while (selection);
 }
 
 // Menu: Patient Management
-void menuPatient(struct Patient patient[], int max) {
+void menuPatient(struct ClinicData* data) {
+    struct Patient* patient = data->patients;
+    int max = data->maxPatient;
     int selection;
     do {
         printf("Patient Management\n"
@@ -121,14 +137,14 @@ void menuPatient(struct Patient patient[], int max) {
             searchPatientData(patient, max);
             break;
         case 3:
-            addPatient(patient, max);
+            addPatient(data);
             suspend();
             break;
         case 4:
-            editPatient(patient, max);
+            editPatient(data);
             break;
         case 5:
-            removePatient(patient, max);
+            removePatient(data);
             suspend();
             break;
         }
@@ -153,7 +169,7 @@ void menuPatientEdit(struct Patient* patient) {
         putchar('\n');
         if (selection == 1) {
             printf("Name  : ");
-            inputCString(patient->name, 1, NAME_LEN);
+            inputPatientName(patient->name);
             putchar('\n');
             printf("Patient record updated!\n\n");
         }
@@ -174,11 +190,13 @@ void menuAppointment(struct ClinicData* data) {
             "2) VIEW   Appointments by DATE\n"
             "3) ADD    Appointment\n"
             "4) REMOVE Appointment\n"
+            "5) VIEW   Utilisation Summary\n"
+            "6) ARCHIVE Old Appointments\n"
             "------------------------------\n"
             "0) Previous menu\n"
             "------------------------------\n"
             "Selection: ");
-        selection = inputIntRange(0, 4);
+        selection = inputIntRange(0, 6);
         putchar('\n');
         switch (selection) {
         case 1:
@@ -190,13 +208,19 @@ void menuAppointment(struct ClinicData* data) {
             suspend();
             break;
         case 3:
-            addAppointment(data->appointments, data->maxAppointments,
-                data->patients, data->maxPatient); 
+            addAppointment(data);
             suspend();
             break;
         case 4:
-            removeAppointment(data->appointments, data->maxAppointments,
-                data->patients, data->maxPatient);
+            removeAppointment(data);
+            suspend();
+            break;
+        case 5:
+            viewAppointmentSummary(data);
+            suspend();
+            break;
+        case 6:
+            archiveAppointments(data);
             suspend();
             break;
         }
@@ -204,6 +228,50 @@ void menuAppointment(struct ClinicData* data) {
 }
 
 
+// Undo the most recent change to the patient or appointment records
+void undoChange(struct ClinicData* data) {
+    struct ChangeLog* log = data->log;
+    struct Change* change;
+    if (log->undone == log->count) printf("Nothing to undo.\n\n");
+    else {
+        log->undone++;
+        change = &log->changes[log->count - log->undone];
+        if (change->type == CHANGE_PATIENT) {
+            data->patients[change->index] = change->patient[0];
+            addPatientFilter(data->filter, change->patient[0].patientNumber);
+            if (change->patient[1].patientNumber > 0 &&
+                change->patient[1].patientNumber != change->patient[0].patientNumber) notePatientRemoved(data);
+            printf("*** Patient record change undone ***\n\n");
+        }
+        else {
+            data->appointments[change->index] = change->appoint[0];
+            printf("*** Appointment record change undone ***\n\n");
+        }
+    }
+}
+
+// Redo the most recently undone change
+void redoChange(struct ClinicData* data) {
+    struct ChangeLog* log = data->log;
+    struct Change* change;
+    if (log->undone == 0) printf("Nothing to redo.\n\n");
+    else {
+        change = &log->changes[log->count - log->undone];
+        log->undone--;
+        if (change->type == CHANGE_PATIENT) {
+            data->patients[change->index] = change->patient[1];
+            addPatientFilter(data->filter, change->patient[1].patientNumber);
+            if (change->patient[0].patientNumber > 0 &&
+                change->patient[0].patientNumber != change->patient[1].patientNumber) notePatientRemoved(data);
+            printf("*** Patient record change redone ***\n\n");
+        }
+        else {
+            data->appointments[change->index] = change->appoint[1];
+            printf("*** Appointment record change redone ***\n\n");
+        }
+    }
+}
+
 // Display's all patient data in the FMT_FORM | FMT_TABLE format
 void displayAllPatients(const struct Patient patient[], int max, int fmt) {
     int i, recordsFound = 0;
@@ -248,7 +316,9 @@ void searchPatientData(const struct Patient patient[], int max) {
 }
 
 // Add a new patient record to the patient array
-void addPatient(struct Patient patient[], int max) {
+void addPatient(struct ClinicData* data) {
+    struct Patient* patient = data->patients;
+    int max = data->maxPatient;
     int index, found = 0;
     for (int i = 0; i < max && found != 1; i++) {
         if (patient[i].patientNumber == 0) {
@@ -258,31 +328,46 @@ void addPatient(struct Patient patient[], int max) {
     }
     if (found != 1) printf("ERROR: Patient listing is FULL!\n\n");
     else {
-        patient[index].patientNumber = nextPatientNumber(patient, max);
-        inputPatient(&patient[index]);
+        // Input goes to a copy: the record is only added once it is complete
+        struct Patient before = patient[index], added = { 0 };
+        added.patientNumber = nextPatientNumber(patient, max);
+        inputPatient(&added);
+        patient[index] = added;
+        addPatientFilter(data->filter, patient[index].patientNumber);
+        recordPatientChange(data, index, &before);
         printf("*** New patient record added ***\n\n");
     }
 }
 
 // Edit a patient record from the patient array
-void editPatient(struct Patient patient[], int max) {
+void editPatient(struct ClinicData* data) {
+    struct Patient* patient = data->patients;
     int num, index;
     printf("Enter the patient number: ");
     num = inputInt();
     printf("\n");
-    index = findPatientIndexByPatientNum(num, patient, max);
+    index = findPatient(data, num);
 
     if (index == -1) printf("ERROR: Patient record not found!\n");
-    else menuPatientEdit(&patient[index]);
+    else {
+        struct Patient before = patient[index];
+        menuPatientEdit(&patient[index]);
+        if (strcmp(before.name, patient[index].name) != 0 ||
+            before.phone.description != patient[index].phone.description ||
+            strcmp(before.phone.number, patient[index].phone.number) != 0) {
+            recordPatientChange(data, index, &before);
+        }
+    }
 }
 
 
 // Remove a patient record from the patient array
-void removePatient(struct Patient patient[], int max) {
+void removePatient(struct ClinicData* data) {
+    struct Patient* patient = data->patients;
     int num, index, confirm;
     printf("Enter the patient number: ");
     num = inputInt();
-    index = findPatientIndexByPatientNum(num, patient, max);
+    index = findPatient(data, num);
     printf("\n");
     if (index == -1) printf("ERROR: Patient record not found!\n\n");
     else {
@@ -290,10 +375,13 @@ void removePatient(struct Patient patient[], int max) {
         printf("\nAre you sure you want to remove this patient record? (y/n): ");
         confirm = inputCharOption("yn");
         if (confirm == 'y') {
+            struct Patient before = patient[index];
             patient[index].patientNumber = 0;
             patient[index].name[0] = '\0';
-            patient[index].phone.description[0] = '\0';
+            patient[index].phone.description = PHONE_NONE;
             patient[index].phone.number[0] = '\0';
+            recordPatientChange(data, index, &before);
+            notePatientRemoved(data);
             printf("Patient record has been removed!\n\n");
         }
         else {
@@ -305,83 +393,303 @@ void removePatient(struct Patient patient[], int max) {
 
 // View ALL scheduled appointments
 void viewAllAppointments(struct ClinicData* data) {    
-    sortAppointment(data->appointments, data->maxAppointments);
+    struct Appointment *visits, *archive = NULL, *next;
+    int i = 0, j = 0, archived = 0;
+    int count = expandAppointments(data->appointments, data->maxAppointments, &visits);
+    if (count == -1) {
+        printf("ERROR: Not enough memory to list appointments!\n\n");
+        return;
+    }
+    archived = importArchive(data->files->archive, &archive);
+    if (archived == -1) archived = 0;
+    sortAppointment(visits, count);
     displayScheduleTableHeader(NULL, 1);
-    for (int i = 0; i < data->maxAppointments; i++) {
-        int patientIndex = findPatientIndexByPatientNum(data->appointments[i].patientNumber, data->patients, data->maxPatient);
-        if (patientIndex != -1) displayScheduleData(&data->patients[patientIndex], &data->appointments[i], 1);
+    // Merge the archive (already in order) with the live visits
+    while (i < count || j < archived) {
+        if (j == archived || (i < count && appointmentKey(&visits[i]) <= appointmentKey(&archive[j]))) next = &visits[i++];
+        else next = &archive[j++];
+        int patientIndex = findPatient(data, next->patientNumber);
+        if (patientIndex != -1) displayScheduleData(&data->patients[patientIndex], next, 1);
     } 
     printf("\n");
+    free(visits);
+    free(archive);
 }
 
 
 // View appointment schedule for the user input date
 void viewAppointmentSchedule(struct ClinicData* data) {
     struct Date date;
+    struct Appointment *visits, *archive = NULL;
+    int i, archived, count = 0;
     isTimeValid(&date.year, &date.month, &date.day);
-    sortAppointment(data->appointments, data->maxAppointments);
+    archived = importArchive(data->files->archive, &archive);
+    if (archived == -1) archived = 0;
+    visits = malloc((data->maxAppointments + archived > 0 ? data->maxAppointments + archived : 1) *
+        sizeof(struct Appointment));
+    if (visits == NULL) {
+        printf("\nERROR: Not enough memory to list appointments!\n\n");
+        free(archive);
+        return;
+    }
+    // Archived visits on this date are listed too
+    for (i = 0; i < archived; i++) {
+        if (dateKey(&archive[i].date) == dateKey(&date)) visits[count++] = archive[i];
+    }
+    // Only the visits on this date are expanded from their series
+    for (i = 0; i < data->maxAppointments; i++) {
+        if (data->appointments[i].patientNumber > 0 &&
+            appointmentOccurs(&data->appointments[i], &date)) {
+            visits[count] = data->appointments[i];
+            visits[count].date = date;
+            visits[count].repeatDays = visits[count].repeatCount = 0;
+            count++;
+        }
+    }
+    sortAppointment(visits, count);
     printf("\n");
     displayScheduleTableHeader(&date, 0);
-    for (int i = 0; i < data->maxAppointments; i++)  {     
-        if (data->appointments[i].date.year == date.year &&
-            data->appointments[i].date.month == date.month &&
-            data->appointments[i].date.day == date.day) {
-            int flag = 1;
-            for (int j = 0; j < data->maxPatient && flag == 1; j++) {
-                if (data->appointments[i].patientNumber == data->patients[j].patientNumber) {
-                    displayScheduleData(&data->patients[j], &data->appointments[i], 0);
-                    flag = 0;
+    for (i = 0; i < count; i++)  {     
+        int patientIndex = findPatient(data, visits[i].patientNumber);
+        if (patientIndex != -1) displayScheduleData(&data->patients[patientIndex], &visits[i], 0);
+    }
+    printf("\n");
+    free(visits);
+    free(archive);
+}
+
+// View per-day utilisation, busiest hours and per-patient visit counts
+// (also written to SUMMARY_FILE)
+void viewAppointmentSummary(struct ClinicData* data) {
+    int hourCount[24] = { 0 };
+    int* visits;
+    struct Appointment* apps;
+    int i, count, dayCount = 0, busiest = -1, index;
+    FILE* fp;
+
+    visits = calloc(data->maxPatient > 0 ? data->maxPatient : 1, sizeof(int));
+    count = expandAppointments(data->appointments, data->maxAppointments, &apps);
+    if (visits == NULL || count == -1) {
+        printf("ERROR: Not enough memory for the summary!\n\n");
+        free(visits);
+        if (count != -1) free(apps);
+        return;
+    }
+    fp = fopen(data->files->summary, "w");
+    if (fp == NULL) printf("Failed to open file '%s'\n", data->files->summary);
+    else fprintf(fp, "type,key,count,capacity\n");
+
+    // Appointments are sorted so each day forms a contiguous run and the
+    // whole summary comes out of a single pass over the array.
+    sortAppointment(apps, count);
+    printf("Clinic Utilisation Summary\n\n"
+        "Date       Booked Slots Used\n"
+        "---------- ------ ----- ----\n");
+    for (i = 0; i < count; i++) {
+        const struct Appointment* app = &apps[i];
+        index = findPatient(data, app->patientNumber);
+        if (app->patientNumber > 0 && index != -1) {
+            dayCount++;
+            visits[index]++;
+            if (app->time.hour >= 0 && app->time.hour < 24) hourCount[app->time.hour]++;
+        }
+        if (dayCount > 0 && (i == count - 1 ||
+            dateKey(&apps[i + 1].date) != dateKey(&app->date))) {
+            int capacity = data->schedule->slotCount[dayOfWeek(app->date.year, app->date.month, app->date.day)];
+            printf("%04d-%02d-%02d %6d %5d %3d%%\n", app->date.year, app->date.month,
+                app->date.day, dayCount, capacity, capacity > 0 ? dayCount * 100 / capacity : 0);
+            if (fp != NULL) fprintf(fp, "day,%04d-%02d-%02d,%d,%d\n", app->date.year,
+                app->date.month, app->date.day, dayCount, capacity);
+            dayCount = 0;
+        }
+    }
+
+    printf("\nHour  Appts\n"
+        "----- -----\n");
+    for (i = 0; i < 24; i++) {
+        if (hourCount[i] > 0) {
+            printf("%02d:00 %5d\n", i, hourCount[i]);
+            if (fp != NULL) fprintf(fp, "hour,%02d:00,%d,\n", i, hourCount[i]);
+            if (busiest == -1 || hourCount[i] > hourCount[busiest]) busiest = i;
+        }
+    }
+    if (busiest != -1) printf("Busiest hour: %02d:00 (%d appointments)\n", busiest, hourCount[busiest]);
+
+    printf("\nPat.# Name            Visits\n"
+        "----- --------------- ------\n");
+    for (i = 0; i < data->maxPatient; i++) {
+        if (visits[i] > 0) {
+            printf("%05d %-15s %6d\n", data->patients[i].patientNumber,
+                data->patients[i].name, visits[i]);
+            if (fp != NULL) fprintf(fp, "patient,%05d,%d,\n",
+                data->patients[i].patientNumber, visits[i]);
+        }
+    }
+    printf("\n");
+
+    if (fp != NULL) {
+        fclose(fp);
+        printf("Summary written to '%s'\n\n", data->files->summary);
+    }
+    free(visits);
+    free(apps);
+}
+
+// Move appointments before a user input date from the appointment array to ARCHIVE_FILE
+// (the patient and appointment files are saved at the same time)
+void archiveAppointments(struct ClinicData* data) {
+    struct Date cutoff;
+    struct Appointment *archive = NULL, *merged, *live, last;
+    int i, n, key, archived, count = 0, moved = 0;
+    long bytes = 0;
+    FILE* fp;
+    if (!data->importComplete) {
+        printf("ERROR: Data files were not fully imported: archiving is disabled!\n\n");
+        return;
+    }
+    printf("Archive appointments before:\n");
+    isTimeValid(&cutoff.year, &cutoff.month, &cutoff.day);
+    printf("\n");
+    key = dateKey(&cutoff);
+    archived = importArchive(data->files->archive, &archive);
+    if (archived == -1) {
+        printf("ERROR: Failed to read archive file '%s'!\n\n", data->files->archive);
+        return;
+    }
+
+    // A record is archived once its last visit is before the cutoff
+    for (i = 0; i < data->maxAppointments; i++) {
+        if (data->appointments[i].patientNumber > 0) {
+            appointmentVisit(&data->appointments[i], appointmentVisits(&data->appointments[i]) - 1, &last);
+            if (dateKey(&last.date) < key) count += appointmentVisits(&data->appointments[i]);
+        }
+    }
+    if (count == 0) {
+        printf("*** No appointments to archive ***\n\n");
+        free(archive);
+        return;
+    }
+    // The old archive and live records are kept until both files are rewritten
+    merged = malloc((archived + count) * sizeof(struct Appointment));
+    live = malloc(data->maxAppointments * sizeof(struct Appointment));
+    if (merged == NULL || live == NULL) {
+        printf("ERROR: Not enough memory to archive appointments!\n\n");
+        free(merged);
+        free(live);
+        free(archive);
+        return;
+    }
+    if (archived > 0) memcpy(merged, archive, archived * sizeof(struct Appointment));
+    memcpy(live, data->appointments, data->maxAppointments * sizeof(struct Appointment));
+    for (i = 0, count = archived; i < data->maxAppointments; i++) {
+        if (data->appointments[i].patientNumber > 0) {
+            appointmentVisit(&data->appointments[i], appointmentVisits(&data->appointments[i]) - 1, &last);
+            if (dateKey(&last.date) < key) {
+                for (n = 0; n < appointmentVisits(&data->appointments[i]); n++) {
+                    appointmentVisit(&data->appointments[i], n, &merged[count++]);
                 }
+                moved++;
             }
         }
     }
-    printf("\n");
+    sortAppointment(merged, count);
+    if (exportArchive(data->files->archive, merged, count) != -1) {
+        // Only clear the live records once the archive is safely on disk
+        for (i = 0; i < data->maxAppointments; i++) {
+            if (data->appointments[i].patientNumber > 0) {
+                appointmentVisit(&data->appointments[i], appointmentVisits(&data->appointments[i]) - 1, &last);
+                if (dateKey(&last.date) < key) data->appointments[i].patientNumber = 0;
+            }
+        }
+        // Save the data files too, so the archived visits can't be loaded twice
+        // (both files are saved, so they always match each other)
+        if (saveClinicData(data) == -1) {
+            memcpy(data->appointments, live, data->maxAppointments * sizeof(struct Appointment));
+            if (archived > 0) exportArchive(data->files->archive, archive, archived);
+            else remove(data->files->archive);
+            printf("ERROR: Data files could not be saved: nothing archived!\n\n");
+        }
+        else {
+            // Archived records can't be restored by undo
+            data->log->count = data->log->undone = 0;
+            fp = fopen(data->files->archive, "r");
+            if (fp != NULL) {
+                fseek(fp, 0, SEEK_END);
+                bytes = ftell(fp);
+                fclose(fp);
+            }
+            printf("*** %d appointment record(s) archived (%d visits in archive, %ld bytes) ***\n\n",
+                moved, count, bytes);
+        }
+    }
+    free(live);
+    free(archive);
+    free(merged);
 }
 
 // Add an appointment record to the appointment array
-void addAppointment(struct Appointment* app, int maxAppointments, struct Patient* pt, int maxPatients) {
-    struct Date date;
-    struct Time time;
-    int num, index, noTime = 1, noPatient = 1, flag;
+void addAppointment(struct ClinicData* data) {
+    struct Appointment* app = data->appointments;
+    int maxAppointments = data->maxAppointments;
+    const struct Schedule* schedule = data->schedule;
+    const struct ClinicHours* hours;
+    struct Appointment appoint;
+    int num, index, weekday, noTime = 1, noPatient = 1;
+    if (nextAppAvailable(app, maxAppointments) == -1) {
+        printf("ERROR: Appointment listing is FULL!\n\n");
+        return;
+    }
+    if (schedule->openDays == 0) {
+        printf("ERROR: The clinic is closed on every day of the week!\n\n");
+        return;
+    }
     while (noPatient) {
         printf("Patient Number: ");
         num = inputIntPositive();
-        index = findPatientIndexByPatientNum(num, pt, maxPatients);
+        index = findPatient(data, num);
         if (index != -1) {
             noPatient = 0;
             do {
-                flag = 1;
-                isTimeValid(&date.year, &date.month, &date.day);
+                isTimeValid(&appoint.date.year, &appoint.date.month, &appoint.date.day);
+                weekday = dayOfWeek(appoint.date.year, appoint.date.month, appoint.date.day);
+                hours = &schedule->hours[weekday];
+                if (!(schedule->openDays & (1 << weekday))) {
+                    printf("\nERROR: The clinic is closed on that day!\n\n");
+                    continue;
+                }
                 printf("Hour (0-23)  : ");
-                time.hour = inputIntRange(0, 23);
+                appoint.time.hour = inputIntRange(0, 23);
                 printf("Minute (0-59): ");
-                time.min = inputIntRange(0, 59);
-                for (int i = 0; i < maxAppointments && flag; i++) {
-                    if (date.year == app[i].date.year &&
-                        date.month == app[i].date.month &&
-                        date.day == app[i].date.day &&
-                        time.hour == app[i].time.hour &&
-                        time.min == app[i].time.min) {
-                        flag = 0;
-                        printf("\nERROR: Appointment timeslot is not available!\n\n");
-                    }
+                appoint.time.min = inputIntRange(0, 59);
+                while (scheduleSlot(schedule, &appoint.date, &appoint.time) == -1) {
+                    printf("ERROR: Time must be between %02d:00 and %02d:00 in %02d minute intervals.\n\n",
+                        hours->start, hours->end, hours->interval);
+                    printf("Hour (0-23)  : ");
+                    appoint.time.hour = inputIntRange(0, 23);
+                    printf("Minute (0-59): ");
+                    appoint.time.min = inputIntRange(0, 59);
                 }
-                if (flag) {
-                    while ((time.hour < START_TIME || time.hour > END_TIME) ||
-                        (time.hour == END_TIME && time.min > 0) ||
-                        (time.min % INTERVAL != 0)) {
-                        printf("ERROR: Time must be between %02d:00 and %02d:00 in %02d minute intervals.\n\n",
-                            START_TIME, END_TIME, INTERVAL);
-                        printf("Hour (0-23)  : ");
-                        time.hour = inputIntRange(0, 23);
-                        printf("Minute (0-59): ");
-                        time.min = inputIntRange(0, 59);
-                    }
+                printf("Repeat every (days, 0 = no repeat): ");
+                appoint.repeatDays = inputIntRange(0, MAX_REPEAT_DAYS);
+                appoint.repeatCount = 0;
+                if (appoint.repeatDays > 0) {
+                    printf("Number of visits (2-%d): ", MAX_REPEAT_COUNT);
+                    appoint.repeatCount = inputIntRange(2, MAX_REPEAT_COUNT);
+                }
+                if (!appointmentInSchedule(schedule, &appoint)) {
+                    printf("\nERROR: A recurring visit falls outside clinic hours!\n\n");
+                }
+                else if (appointmentConflicts(&appoint, app, maxAppointments) ||
+                    archiveConflicts(data, &appoint)) {
+                    printf("\nERROR: Appointment timeslot is not available!\n\n");
+                }
+                else {
                     noTime = 0;
                     index = nextAppAvailable(app, maxAppointments);
-                    app[index].date = date;
-                    app[index].time = time;
-                    app[index].patientNumber = num;
+                    appoint.patientNumber = num;
+                    struct Appointment before = app[index];
+                    app[index] = appoint;
+                    recordAppointmentChange(data, index, &before);
                     printf("\n*** Appointment scheduled! ***\n\n");
                 }
 
@@ -392,28 +700,42 @@ void addAppointment(struct Appointment* app, int maxAppointments, struct Patient
 }
 
 // Remove an appointment record from the appointment array
-void removeAppointment(struct Appointment* app, int maxAppointments, struct Patient* pt, int maxPatients) {
+void removeAppointment(struct ClinicData* data) {
+    struct Appointment* app = data->appointments;
+    int maxAppointments = data->maxAppointments;
+    struct Patient* pt = data->patients;
     struct Date date;
     int i, num, index, confirm;
     printf("Patient Number: ");
     num = inputIntPositive();
-    index = findPatientIndexByPatientNum(num, pt, maxPatients);
+    index = findPatient(data, num);
     if (index != -1) {
         isTimeValid(&date.year, &date.month, &date.day);
         int found = 0;
         for (i = 0; i < maxAppointments && found!= 1; i++) {
             if (app[i].patientNumber == num &&
-                app[i].date.year == date.year &&
-                app[i].date.month == date.month &&
-                app[i].date.day == date.day) {
+                appointmentOccurs(&app[i], &date)) {
                 found = 1;
                 printf("\n");
                 displayPatientData(&pt[index], FMT_FORM);
-                printf("Are you sure you want to remove this appointment (y,n): ");
+                // A series is stored as one record: say how many visits go with it
+                if (appointmentVisits(&app[i]) > 1) {
+                    printf("This is visit %d of a series of %d visits (every %d days from %04d-%02d-%02d).\n",
+                        (dateKey(&date) - dateKey(&app[i].date)) / app[i].repeatDays + 1,
+                        appointmentVisits(&app[i]), app[i].repeatDays,
+                        app[i].date.year, app[i].date.month, app[i].date.day);
+                    printf("Are you sure you want to remove ALL %d visits of this series (y,n): ",
+                        appointmentVisits(&app[i]));
+                }
+                else printf("Are you sure you want to remove this appointment (y,n): ");
                 confirm = inputCharOption("yn");
                 if (confirm == 'y') {
+                    struct Appointment before = app[i];
                     app[i].patientNumber = 0;
-                    printf("\nAppointment record has been removed!\n\n");
+                    recordAppointmentChange(data, i, &before);
+                    if (appointmentVisits(&app[i]) > 1) printf("\nAppointment series (%d visits) has been removed!\n\n",
+                        appointmentVisits(&app[i]));
+                    else printf("\nAppointment record has been removed!\n\n");
                 }
             }
         }
@@ -479,53 +801,503 @@ int findPatientIndexByPatientNum(int patientNumber, const struct Patient patient
 }
 
 
-//Retrieves the index of the next available appointment,
+// Bit positions for a patient number (double hashing over the filter size)
+static unsigned int patientFilterBit(const struct PatientFilter* filter, int patientNumber, int n)
+{
+    unsigned int h1 = (unsigned int)patientNumber * 0x9E3779B1u;
+    unsigned int h2 = ((unsigned int)patientNumber * 0x85EBCA6Bu) | 1u;
+    unsigned int bit = h1 + n * h2;
+    // The low product bits of nearby numbers barely differ: fold the high bits in
+    return (bit ^ (bit >> 16)) & (filter->size - 1);
+}
+
+// Allocate a patient number filter sized for max patients (returns 0 on success, -1 on error)
+int initPatientFilter(struct PatientFilter* filter, int max)
+{
+    filter->size = PATIENT_FILTER_MIN_BITS;
+    while (filter->size < (unsigned int)max * PATIENT_FILTER_BITS_PER_ENTRY) filter->size *= 2;
+    filter->bits = calloc(filter->size / 8, 1);
+    filter->stale = 0;
+    return filter->bits == NULL ? -1 : 0;
+}
+
+// Free the memory of a patient number filter
+void freePatientFilter(struct PatientFilter* filter)
+{
+    free(filter->bits);
+    filter->bits = NULL;
+    filter->size = 0;
+}
+
+// Rebuild the patient number filter from the patient array
+void buildPatientFilter(struct PatientFilter* filter, const struct Patient patient[], int max)
+{
+    memset(filter->bits, 0, filter->size / 8);
+    filter->stale = 0;
+    for (int i = 0; i < max; i++) {
+        if (patient[i].patientNumber > 0) addPatientFilter(filter, patient[i].patientNumber);
+    }
+}
+
+// Add a patient number to the patient number filter
+void addPatientFilter(struct PatientFilter* filter, int patientNumber)
+{
+    unsigned int bit;
+    if (filter != NULL && patientNumber > 0) {
+        for (int n = 0; n < PATIENT_FILTER_HASHES; n++) {
+            bit = patientFilterBit(filter, patientNumber, n);
+            filter->bits[bit / 8] |= 1u << (bit % 8);
+        }
+    }
+}
+
+// Note that a patient number was removed from the clinic's patient array: the filter can't
+// drop a number, so it is rebuilt once too many removed numbers are still set in it
+void notePatientRemoved(struct ClinicData* data)
+{
+    if (data->filter != NULL && ++data->filter->stale > data->maxPatient / PATIENT_FILTER_STALE) {
+        buildPatientFilter(data->filter, data->patients, data->maxPatient);
+    }
+}
+
+// Check the patient number filter (returns 0 if the patient number is definitely not in use)
+int mayHavePatient(const struct PatientFilter* filter, int patientNumber)
+{
+    unsigned int bit;
+    int found = 1;
+    for (int n = 0; n < PATIENT_FILTER_HASHES && found; n++) {
+        bit = patientFilterBit(filter, patientNumber, n);
+        found = (filter->bits[bit / 8] >> (bit % 8)) & 1u;
+    }
+    return found;
+}
+
+// Find the patient array index by patient number using the clinic's filter (returns -1 if not found)
+int findPatient(const struct ClinicData* data, int patientNumber)
+{
+    int index = -1;
+    // Removed patients stay in the filter, so a hit still needs the scan to confirm
+    if (patientNumber > 0 && (data->filter == NULL || mayHavePatient(data->filter, patientNumber))) {
+        index = findPatientIndexByPatientNum(patientNumber, data->patients, data->maxPatient);
+    }
+    return index;
+}
+
+// Set every weekday to the default clinic hours (START_TIME, END_TIME, INTERVAL)
+void initSchedule(struct Schedule* schedule)
+{
+    for (int weekday = 0; weekday < DAYS_PER_WEEK; weekday++) {
+        setScheduleHours(schedule, weekday, START_TIME, END_TIME, INTERVAL);
+    }
+}
+
+// Set the clinic hours of one weekday and rebuild its slot table (interval 0 closes the day)
+void setScheduleHours(struct Schedule* schedule, int weekday, int start, int end, int interval)
+{
+    int minute, slot = 0;
+    if (start < 0 || end > 24 || start >= end || interval <= 0) start = end = interval = 0;
+    schedule->hours[weekday].start = start;
+    schedule->hours[weekday].end = end;
+    schedule->hours[weekday].interval = interval;
+    for (minute = 0; minute < MINUTES_PER_DAY; minute++) {
+        if (interval > 0 && minute >= start * 60 && minute <= end * 60 &&
+            (minute - start * 60) % interval == 0) {
+            schedule->slotOf[weekday][minute] = slot++;
+        }
+        else schedule->slotOf[weekday][minute] = -1;
+    }
+    schedule->slotCount[weekday] = slot;
+    if (slot > 0) schedule->openDays |= 1 << weekday;
+    else schedule->openDays &= ~(1 << weekday);
+}
+
+// Get the slot index of a date and time (returns -1 if it isn't a bookable slot)
+int scheduleSlot(const struct Schedule* schedule, const struct Date* date, const struct Time* time)
+{
+    int minute = time->hour * 60 + time->min, slot = -1;
+    if (minute >= 0 && minute < MINUTES_PER_DAY && time->min >= 0 && time->min < 60) {
+        slot = schedule->slotOf[dayOfWeek(date->year, date->month, date->day)][minute];
+    }
+    return slot;
+}
+
+// Check that every visit of an appointment is on a bookable slot
+int appointmentInSchedule(const struct Schedule* schedule, const struct Appointment* appoint)
+{
+    struct Appointment visit;
+    int n, valid = 1;
+    for (n = 0; n < appointmentVisits(appoint) && valid; n++) {
+        appointmentVisit(appoint, n, &visit);
+        valid = scheduleSlot(schedule, &visit.date, &visit.time) != -1;
+    }
+    return valid;
+}
+
+//Retrieves the index of the next available appointment (returns -1 if the array is full)
 int nextAppAvailable(struct Appointment* app, int max) {
-    int i = 0, found = 0;
-    for (i = 0; i < max && found != 1; i++) {
-        if (app[i].patientNumber < 1) found = 1;
+    int i, index = -1;
+    for (i = 0; i < max && index == -1; i++) {
+        if (app[i].patientNumber < 1) index = i;
     }
-    return i;
+    return index;
 }
 
-//Sort the appointment array in chronological order based on the appointment date and time. 
-void sortAppointment(struct Appointment* appoints, int max)
+// Get the number of visits of an appointment (1 unless it is a recurring series)
+int appointmentVisits(const struct Appointment* appoint)
+{
+    return appoint->repeatDays > 0 && appoint->repeatCount > 1 ? appoint->repeatCount : 1;
+}
+
+// Check if any visit of an appointment is on the date and time of an archived visit
+// (returns 1 if so or if the archive can't be read, 0 otherwise)
+int archiveConflicts(const struct ClinicData* data, const struct Appointment* appoint)
+{
+    struct Appointment* archive;
+    struct Appointment visit;
+    long long key;
+    int n, low, high, mid, conflict = 0;
+    int archived = importArchive(data->files->archive, &archive);
+    if (archived == -1) {
+        printf("\nERROR: Failed to read archive file '%s'!", data->files->archive);
+        return 1;
+    }
+    // The archive is sorted by date and time
+    for (n = 0; n < appointmentVisits(appoint) && !conflict; n++) {
+        appointmentVisit(appoint, n, &visit);
+        key = appointmentKey(&visit);
+        for (low = 0, high = archived - 1; low <= high && !conflict; ) {
+            mid = (low + high) / 2;
+            if (appointmentKey(&archive[mid]) < key) low = mid + 1;
+            else if (appointmentKey(&archive[mid]) > key) high = mid - 1;
+            else conflict = 1;
+        }
+    }
+    free(archive);
+    return conflict;
+}
+
+// Get the n-th visit (from 0) of an appointment as a single appointment
+void appointmentVisit(const struct Appointment* appoint, int n, struct Appointment* visit)
+{
+    *visit = *appoint;
+    visit->repeatDays = visit->repeatCount = 0;
+    if (n > 0) {
+        daysToDate(dateToDays(appoint->date.year, appoint->date.month, appoint->date.day) +
+            n * appoint->repeatDays, &visit->date.year, &visit->date.month, &visit->date.day);
+    }
+}
+
+// Check if an appointment (single or recurring) has a visit on the date
+int appointmentOccurs(const struct Appointment* appoint, const struct Date* date)
+{
+    int days, occurs = dateKey(&appoint->date) == dateKey(date);
+    if (!occurs && appointmentVisits(appoint) > 1) {
+        days = dateToDays(date->year, date->month, date->day) -
+            dateToDays(appoint->date.year, appoint->date.month, appoint->date.day);
+        occurs = days > 0 && days % appoint->repeatDays == 0 &&
+            days / appoint->repeatDays < appoint->repeatCount;
+    }
+    return occurs;
+}
+
+// Check if any visit of an appointment clashes with a visit in the appointment array
+int appointmentConflicts(const struct Appointment* appoint, const struct Appointment app[], int max)
+{
+    struct Appointment visit;
+    int i, n, conflict = 0;
+    for (i = 0; i < max && !conflict; i++) {
+        if (app[i].patientNumber > 0 &&
+            app[i].time.hour == appoint->time.hour && app[i].time.min == appoint->time.min) {
+            for (n = 0; n < appointmentVisits(appoint) && !conflict; n++) {
+                appointmentVisit(appoint, n, &visit);
+                conflict = appointmentOccurs(&app[i], &visit.date);
+            }
+        }
+    }
+    return conflict;
+}
+
+// Expand all appointments into single visits (returns # of visits, -1 if out of memory)
+// The caller must free() the returned array
+int expandAppointments(const struct Appointment app[], int max, struct Appointment** visits)
+{
+    int i, n, count = 0;
+    for (i = 0; i < max; i++) {
+        if (app[i].patientNumber > 0) count += appointmentVisits(&app[i]);
+    }
+    *visits = malloc((count > 0 ? count : 1) * sizeof(struct Appointment));
+    if (*visits == NULL) return -1;
+    count = 0;
+    for (i = 0; i < max; i++) {
+        if (app[i].patientNumber > 0) {
+            for (n = 0; n < appointmentVisits(&app[i]); n++) {
+                appointmentVisit(&app[i], n, &(*visits)[count++]);
+            }
+        }
+    }
+    return count;
+}
+
+// Add a change to the log, dropping redo history and the oldest change when full
+static struct Change* pushChange(struct ChangeLog* log, int type, int index)
+{
+    struct Change* change;
+    log->count -= log->undone;
+    log->undone = 0;
+    if (log->count == UNDO_DEPTH) {
+        memmove(&log->changes[0], &log->changes[1], (UNDO_DEPTH - 1) * sizeof(struct Change));
+        log->count--;
+    }
+    change = &log->changes[log->count++];
+    change->type = type;
+    change->index = index;
+    return change;
+}
+
+// Record a change to a patient record (before: the record as it was before the change)
+void recordPatientChange(struct ClinicData* data, int index, const struct Patient* before)
+{
+    struct Change* change = pushChange(data->log, CHANGE_PATIENT, index);
+    change->patient[0] = *before;
+    change->patient[1] = data->patients[index];
+}
+
+// Record a change to an appointment record (before: the record as it was before the change)
+void recordAppointmentChange(struct ClinicData* data, int index, const struct Appointment* before)
+{
+    struct Change* change = pushChange(data->log, CHANGE_APPOINTMENT, index);
+    change->appoint[0] = *before;
+    change->appoint[1] = data->appointments[index];
+}
+
+// A record reference sorted by key, used to find duplicate keys
+struct RecordKey {
+    long long key;
+    int index;
+};
+
+// qsort comparator: orders record keys by key, then by array index
+static int compareRecordKeys(const void* a, const void* b)
 {
-    int i;
-    struct Appointment temp;
-    int flag = 1;
-
-    while (flag) {
-        flag = 0;
-        for (i = 0; i < max - 1; i++) {
-            if (appoints[i].date.year > appoints[i + 1].date.year ||
-                (appoints[i].date.year == appoints[i + 1].date.year &&
-                    appoints[i].date.month > appoints[i + 1].date.month) ||
-                (appoints[i].date.year == appoints[i + 1].date.year &&
-                    appoints[i].date.month == appoints[i + 1].date.month &&
-                    appoints[i].date.day > appoints[i + 1].date.day) ||
-                (appoints[i].date.year == appoints[i + 1].date.year &&
-                    appoints[i].date.month == appoints[i + 1].date.month &&
-                    appoints[i].date.day == appoints[i + 1].date.day &&
-                    appoints[i].time.hour > appoints[i + 1].time.hour) ||
-                (appoints[i].date.year == appoints[i + 1].date.year &&
-                    appoints[i].date.month == appoints[i + 1].date.month &&
-                    appoints[i].date.day == appoints[i + 1].date.day &&
-                    appoints[i].time.hour == appoints[i + 1].time.hour &&
-                    appoints[i].time.min > appoints[i + 1].time.min)) {
-                temp = appoints[i];
-                appoints[i] = appoints[i + 1];
-                appoints[i + 1] = temp;
-                flag = 1;
+    const struct RecordKey* keyA = a;
+    const struct RecordKey* keyB = b;
+    if (keyA->key != keyB->key) return (keyA->key > keyB->key) - (keyA->key < keyB->key);
+    return keyA->index - keyB->index;
+}
+
+// bsearch comparator: matches a record key by key only
+static int compareKeyOnly(const void* a, const void* b)
+{
+    long long keyA = ((const struct RecordKey*)a)->key;
+    long long keyB = ((const struct RecordKey*)b)->key;
+    return (keyA > keyB) - (keyA < keyB);
+}
+
+// Check if a number is in an array of record keys sorted by key
+static int hasRecordKey(const struct RecordKey keys[], int count, long long key)
+{
+    struct RecordKey find;
+    find.key = key;
+    return bsearch(&find, keys, count, sizeof(struct RecordKey), compareKeyOnly) != NULL;
+}
+
+// Check that an appointment has a valid date, time and repeat rule
+static int isAppointmentValid(const struct Appointment* appoint)
+{
+    return appoint->date.year >= MIN_YEAR && appoint->date.year <= MAX_YEAR &&
+        appoint->date.day >= 1 &&
+        appoint->date.day <= daysInMonth(appoint->date.year, appoint->date.month) &&
+        appoint->time.hour >= 0 && appoint->time.hour <= 23 &&
+        appoint->time.min >= 0 && appoint->time.min <= 59 &&
+        appoint->repeatDays >= 0 && appoint->repeatDays <= MAX_REPEAT_DAYS &&
+        appoint->repeatCount >= 0 && appoint->repeatCount <= MAX_REPEAT_COUNT;
+}
+
+// Check the loaded records for duplicate patients, invalid appointments, appointments
+// of missing patients and double-booked slots (returns # of problems found)
+int verifyClinicData(struct ClinicData* data, int repair)
+{
+    struct Patient* patient = data->patients;
+    struct Appointment* app = data->appointments;
+    struct Appointment visit;
+    struct RecordKey *keys, *patientKeys;
+    char* removed;
+    int i, n, run, kept, count, patientCount, problems = 0;
+    const char* action = repair ? "removed" : "kept";
+
+    // Duplicate patient numbers: sort by number, the first record of each number is kept
+    patientKeys = malloc((data->maxPatient > 0 ? data->maxPatient : 1) * sizeof(struct RecordKey));
+    if (patientKeys == NULL) {
+        printf("ERROR: Not enough memory to check clinic data!\n");
+        return -1;
+    }
+    for (i = 0, patientCount = 0; i < data->maxPatient; i++) {
+        if (patient[i].patientNumber > 0) {
+            patientKeys[patientCount].key = patient[i].patientNumber;
+            patientKeys[patientCount++].index = i;
+        }
+        else if (patient[i].patientNumber < 0) {
+            printf("WARNING: Invalid patient number %d (record %s)\n", patient[i].patientNumber, action);
+            if (repair) patient[i].patientNumber = 0;
+            problems++;
+        }
+    }
+    qsort(patientKeys, patientCount, sizeof(struct RecordKey), compareRecordKeys);
+    for (i = 1; i < patientCount; i++) {
+        if (patientKeys[i].key == patientKeys[i - 1].key) {
+            printf("WARNING: Duplicate patient number %05d (record %s)\n", (int)patientKeys[i].key, action);
+            if (repair) patient[patientKeys[i].index].patientNumber = 0;
+            problems++;
+        }
+    }
+
+    // Invalid dates and appointments of missing patients
+    // (the sorted patient numbers stand in for a table scan per appointment)
+    for (i = 0, count = 0; i < data->maxAppointments; i++) {
+        if (app[i].patientNumber != 0) {
+            if (!isAppointmentValid(&app[i])) {
+                printf("WARNING: Invalid date/time %04d-%02d-%02d %02d:%02d for patient %05d (appointment %s)\n",
+                    app[i].date.year, app[i].date.month, app[i].date.day, app[i].time.hour,
+                    app[i].time.min, app[i].patientNumber, action);
+                if (repair) app[i].patientNumber = 0;
+                problems++;
             }
+            else if (!hasRecordKey(patientKeys, patientCount, app[i].patientNumber)) {
+                printf("WARNING: Appointment %04d-%02d-%02d %02d:%02d for missing patient %05d (appointment %s)\n",
+                    app[i].date.year, app[i].date.month, app[i].date.day, app[i].time.hour,
+                    app[i].time.min, app[i].patientNumber, action);
+                if (repair) app[i].patientNumber = 0;
+                problems++;
+            }
+            else count += appointmentVisits(&app[i]);
+        }
+    }
+
+    // Double-booked slots: sort every visit by date and time, the first record of each slot is kept
+    // (removed marks the records already reported, so a report matches the repair)
+    keys = malloc((count > 0 ? count : 1) * sizeof(struct RecordKey));
+    removed = calloc(data->maxAppointments > 0 ? data->maxAppointments : 1, sizeof(char));
+    if (keys == NULL || removed == NULL) {
+        printf("ERROR: Not enough memory to check clinic data!\n");
+        free(keys);
+        free(removed);
+        free(patientKeys);
+        return -1;
+    }
+    for (i = 0, count = 0; i < data->maxAppointments; i++) {
+        if (app[i].patientNumber > 0 && isAppointmentValid(&app[i]) &&
+            hasRecordKey(patientKeys, patientCount, app[i].patientNumber)) {
+            for (n = 0; n < appointmentVisits(&app[i]); n++) {
+                appointmentVisit(&app[i], n, &visit);
+                keys[count].key = appointmentKey(&visit);
+                keys[count++].index = i;
+            }
+        }
+    }
+    qsort(keys, count, sizeof(struct RecordKey), compareRecordKeys);
+    // In a run of equal keys one record keeps the slot and every other record clashes with it.
+    // The record with the most visits is kept (the first one on a tie), so a single visit
+    // is removed rather than a whole series.
+    for (i = 0; i < count; i = run) {
+        kept = -1;
+        for (run = i; run < count && keys[run].key == keys[i].key; run++) {
+            n = keys[run].index;
+            if (app[n].patientNumber > 0 && !removed[n] &&
+                (kept == -1 || appointmentVisits(&app[n]) > appointmentVisits(&app[kept]))) kept = n;
         }
+        daysToDate((int)(keys[i].key / MINUTES_PER_DAY), &visit.date.year, &visit.date.month, &visit.date.day);
+        for (run = i; run < count && keys[run].key == keys[i].key; run++) {
+            n = keys[run].index;
+            if (n == kept || app[n].patientNumber <= 0 || removed[n]) continue;
+            printf("WARNING: Double-booked slot %04d-%02d-%02d %02d:%02d for patient %05d ",
+                visit.date.year, visit.date.month, visit.date.day,
+                (int)(keys[i].key % MINUTES_PER_DAY) / 60, (int)(keys[i].key % MINUTES_PER_DAY) % 60,
+                app[n].patientNumber);
+            if (appointmentVisits(&app[n]) > 1) printf("(whole series of %d visits %s)\n", appointmentVisits(&app[n]), action);
+            else printf("(appointment %s)\n", action);
+            if (repair) app[n].patientNumber = 0;
+            removed[n] = 1;
+            problems++;
+        }
+    }
+    free(removed);
+    free(keys);
+    free(patientKeys);
+    return problems;
+}
+
+// Save the patient and appointment arrays to the clinic's data files (returns 0 on success, -1 on error)
+int saveClinicData(const struct ClinicData* data)
+{
+    int patientCount, appointmentCount = -1;
+    patientCount = exportPatients(data->files->patients, data->patients, data->maxPatient);
+    if (patientCount >= 0) {
+        printf("Exported %d patient records...\n", patientCount);
+        appointmentCount = exportAppointments(data->files->appointments, data->appointments, data->maxAppointments);
+        if (appointmentCount >= 0) printf("Exported %d appointment records...\n", appointmentCount);
+    }
+    return appointmentCount >= 0 ? 0 : -1;
+}
+
+// Get the display text for a phone description ("CELL", "HOME", "WORK", "TBD")
+const char* phoneDescription(int description)
+{
+    static const char* const text[] = { "", "CELL", "HOME", "WORK", "TBD" };
+    if (description < PHONE_NONE || description > PHONE_TBD) description = PHONE_NONE;
+    return text[description];
+}
+
+// Convert phone description text to its PhoneDescription value (PHONE_NONE if unknown)
+int parsePhoneDescription(const char string[])
+{
+    int description = PHONE_TBD;
+    while (description > PHONE_NONE && strcmp(string, phoneDescription(description)) != 0) {
+        description--;
     }
+    return description;
+}
+
+// Chronological key for a date (its day number)
+int dateKey(const struct Date* date)
+{
+    return dateToDays(date->year, date->month, date->day);
+}
+
+// Chronological key for an appointment date and time (minutes since day number 0)
+long long appointmentKey(const struct Appointment* appoint)
+{
+    return (long long)dateKey(&appoint->date) * MINUTES_PER_DAY +
+        appoint->time.hour * 60 + appoint->time.min;
+}
+
+// qsort comparator: orders appointments by their date/time key
+static int compareAppointments(const void* a, const void* b)
+{
+    long long keyA = appointmentKey((const struct Appointment*)a);
+    long long keyB = appointmentKey((const struct Appointment*)b);
+    return (keyA > keyB) - (keyA < keyB);
+}
+
+//Sort the appointment array in chronological order based on the appointment date and time. 
+void sortAppointment(struct Appointment* appoints, int max)
+{
+    qsort(appoints, max, sizeof(struct Appointment), compareAppointments);
 }
 
 //////////////////////////////////////
 // USER INPUT FUNCTIONS
 //////////////////////////////////////
 
+// Get user input for a patient name ('|' separates the data file fields, so it is rejected)
+void inputPatientName(char name[])
+{
+    inputCString(name, 1, NAME_LEN);
+    while (strchr(name, '|') != NULL) {
+        printf("ERROR: Name can't contain the '|' character: ");
+        inputCString(name, 1, NAME_LEN);
+    }
+}
+
 // Get user input for a new patient record
 void inputPatient(struct Patient* patient) {
     char patientName[NAME_LEN + 1];
@@ -533,7 +1305,7 @@ void inputPatient(struct Patient* patient) {
         "------------------\n");
     printf("Number: %05d\n", patient->patientNumber);
     printf("Name  : ");
-    inputCString(patientName, 1, NAME_LEN);
+    inputPatientName(patientName);
     strcpy(patient->name, patientName);
     printf("\n");
     inputPhoneData(&patient->phone);
@@ -554,86 +1326,327 @@ void inputPhoneData(struct Phone* phone) {
         "Selection: ");
     selection = inputIntRange(1, 4);
     putchar('\n');
-    switch (selection) {
-    case 1:
-        strcpy(phone->description, "CELL");
-        printf("Contact: %s\n", phone->description);
-        printf("Number : ");
-        inputCStringDigit(phoneNumber, 10);
-        strcpy(phone->number, phoneNumber);
-        printf("\n");
-        break;
-    case 2:
-        strcpy(phone->description, "HOME");
-        printf("Contact: %s\n", phone->description);
-        printf("Number : ");
-        inputCStringDigit(phoneNumber, 10);
-        strcpy(phone->number, phoneNumber);
-        printf("\n");
-        break;
-    case 3:
-        strcpy(phone->description, "WORK");
-        printf("Contact: %s\n", phone->description);
+    if (selection == PHONE_TBD) phoneNumber[0] = '\0';
+    else {
+        printf("Contact: %s\n", phoneDescription(selection));
         printf("Number : ");
         inputCStringDigit(phoneNumber, 10);
-        strcpy(phone->number, phoneNumber);
         printf("\n");
-        break;
-    case 4:
-        strcpy(phone->description, "TBD");
-        phone->number[0] = '\0';
-        break;
     }
+    // Both fields change together, after all input is read
+    phone->description = selection;
+    strcpy(phone->number, phoneNumber);
 }
 
 //////////////////////////////////////
 // FILE FUNCTIONS
 //////////////////////////////////////
 
+// Build the path of a data file inside a directory (returns 0 on success, -1 if too long)
+static int clinicFilePath(char path[], const char* directory, const char* filename)
+{
+    int len;
+    if (directory == NULL || directory[0] == '\0')
+        len = snprintf(path, FILENAME_MAX, "%s", filename);
+    else if (directory[strlen(directory) - 1] == '/' || directory[strlen(directory) - 1] == '\\')
+        len = snprintf(path, FILENAME_MAX, "%s%s", directory, filename);
+    else
+        len = snprintf(path, FILENAME_MAX, "%s/%s", directory, filename);
+    return len < 0 || len >= FILENAME_MAX ? -1 : 0;
+}
+
+// Set the data file paths of a clinic kept in a directory ("" or NULL = current directory)
+// (returns 0 on success, -1 if a path is too long)
+int setClinicFiles(struct ClinicFiles* files, const char* directory)
+{
+    return clinicFilePath(files->patients, directory, PATIENT_FILE)
+        | clinicFilePath(files->appointments, directory, APPOINTMENT_FILE)
+        | clinicFilePath(files->schedule, directory, SCHEDULE_FILE)
+        | clinicFilePath(files->summary, directory, SUMMARY_FILE)
+        | clinicFilePath(files->archive, directory, ARCHIVE_FILE);
+}
+
+// Count the records (non-empty lines) in a data file (returns 0 if the file can't be opened)
+int countRecords(const char* datafile)
+{
+    int count = 0, ch, prev = '\n';
+    FILE* fp;
+    fp = fopen(datafile, "r");
+    if (fp != NULL) {
+        while ((ch = fgetc(fp)) != EOF) {
+            if (ch != '\n' && prev == '\n') count++;
+            prev = ch;
+        }
+        fclose(fp);
+    }
+    return count;
+}
+
+// Read the next non-empty line of a data file without its newline (returns 0 at end of file)
+// The rest of a line longer than the buffer is discarded and *truncated is set
+static int readRecordLine(FILE* fp, char line[], int size, int* truncated)
+{
+    int len, ch;
+    do {
+        if (fgets(line, size, fp) == NULL) return 0;
+        len = (int)strlen(line);
+    } while (line[0] == '\n');
+    *truncated = 0;
+    if (line[len - 1] == '\n') line[--len] = '\0';
+    else {
+        while ((ch = fgetc(fp)) != '\n' && ch != EOF) *truncated = 1;
+    }
+    if (len > 0 && line[len - 1] == '\r') line[--len] = '\0';
+    return 1;
+}
+
+// Copy the next '|' separated field of a record line, truncated to fit field[size]
+// (returns the rest of the line after the separator, NULL if this was the last field)
+static const char* nextField(const char* line, char field[], int size, int* truncated)
+{
+    int len = (int)strcspn(line, "|");
+    if (len >= size) {
+        *truncated = 1;
+        len = size - 1;
+    }
+    strncpy(field, line, len);
+    field[len] = '\0';
+    line = strchr(line, '|');
+    return line != NULL ? line + 1 : NULL;
+}
+
 // Import patient data from file into a Patient array (returns # of records read)
+// Over-long fields are truncated, unknown contact types become TBD and unreadable lines
+// are skipped (all with a warning)
 int importPatients(const char* datafile, struct Patient patients[], int max)
 {
-    int count=0;
+    int count = 0, lineNumber = 0, offset, truncated;
+    char line[RECORD_LINE_LEN], description[PHONE_DESC_LEN + 1];
+    const char* field;
     FILE* fp;
     fp = fopen(datafile, "r");
     
     if (fp == NULL) printf("Failed to open file '%s'\n", datafile);
     else {
-        while (count < max && !feof(fp)) {
-            fscanf(fp, "%d|%[^|]|%[^|]|%[^\n]",
-                &patients[count].patientNumber,
-                patients[count].name,
-                patients[count].phone.description,
-                patients[count].phone.number);
+        while (count < max && readRecordLine(fp, line, RECORD_LINE_LEN, &truncated)) {
+            lineNumber++;
+            offset = 0;
+            // TBD contacts have no number, so only the first three fields are required
+            sscanf(line, "%d|%n", &patients[count].patientNumber, &offset);
+            field = offset > 0 ? nextField(line + offset, patients[count].name, NAME_LEN + 1, &truncated) : NULL;
+            if (field == NULL || patients[count].name[0] == '\0') {
+                printf("WARNING: '%s' line %d is not a patient record (skipped)\n", datafile, lineNumber);
+                memset(&patients[count], 0, sizeof(struct Patient));
+                continue;
+            }
+            field = nextField(field, description, PHONE_DESC_LEN + 1, &truncated);
+            if (field != NULL) nextField(field, patients[count].phone.number, PHONE_LEN + 1, &truncated);
+            else patients[count].phone.number[0] = '\0';
+            patients[count].phone.description = parsePhoneDescription(description);
+            if (patients[count].phone.description == PHONE_NONE) {
+                printf("WARNING: '%s' line %d has an unknown contact type '%s' (set to TBD)\n",
+                    datafile, lineNumber, description);
+                patients[count].phone.description = PHONE_TBD;
+            }
+            if (truncated) {
+                printf("WARNING: '%s' line %d has an over-long field (truncated)\n", datafile, lineNumber);
+            }
             count++;
         }
+        fclose(fp);
     }
-    fclose(fp);
     return count;
 }
 
 
 // Import appointment data from file into an Appointment array (returns # of records read)
+// Unreadable lines are skipped with a warning
 int importAppointments(const char* datafile, struct Appointment appoints[], int max) {
-    int count = 0;
+    int count = 0, lineNumber = 0, fields, truncated;
+    char line[RECORD_LINE_LEN];
     FILE* fp;
     fp = fopen(datafile, "r");
     if (fp == NULL) printf("Failed to open file '%s'\n", datafile);
     else {
-        while (count < max && !feof(fp)) {
-            fscanf(fp, "%d,%d,%d,%d,%d,%d\n",
+        while (count < max && readRecordLine(fp, line, RECORD_LINE_LEN, &truncated)) {
+            lineNumber++;
+            // Recurring series carry two extra fields: days between visits, number of visits
+            fields = sscanf(line, "%d,%d,%d,%d,%d,%d,%d,%d",
                 &appoints[count].patientNumber,
                 &appoints[count].date.year,
                 &appoints[count].date.month,
                 &appoints[count].date.day,
                 &appoints[count].time.hour,
-                &appoints[count].time.min);
+                &appoints[count].time.min,
+                &appoints[count].repeatDays,
+                &appoints[count].repeatCount);
+            if (truncated || (fields != 6 && fields != 8)) {
+                printf("WARNING: '%s' line %d is not an appointment record (skipped)\n", datafile, lineNumber);
+                memset(&appoints[count], 0, sizeof(struct Appointment));
+                continue;
+            }
+            if (fields == 6) appoints[count].repeatDays = appoints[count].repeatCount = 0;
             count++;
         }
+        fclose(fp);
     }
-    fclose(fp);
     return count;
 }
 
+// Open a temporary file next to datafile for a buffered export (returns NULL on error)
+static FILE* openExportFile(const char* datafile, char tempfile[], int size)
+{
+    FILE* fp = NULL;
+    if (snprintf(tempfile, size, "%s.tmp", datafile) < size) {
+        fp = fopen(tempfile, "w");
+        if (fp != NULL) setvbuf(fp, NULL, _IOFBF, EXPORT_BUFFER_SIZE);
+    }
+    if (fp == NULL) printf("Failed to open file '%s'\n", datafile);
+    return fp;
+}
+
+// Flush and close the temporary file and move it over datafile (returns 0 on success)
+static int commitExportFile(FILE* fp, const char* tempfile, const char* datafile)
+{
+    int result = ferror(fp);
+    result = fclose(fp) != 0 || result;
+#ifdef _WIN32
+    // rename() does not replace an existing file on Windows
+    if (!result) result = !MoveFileExA(tempfile, datafile, MOVEFILE_REPLACE_EXISTING);
+#else
+    if (!result) result = rename(tempfile, datafile) != 0;
+#endif
+    if (result) {
+        remove(tempfile);
+        printf("Failed to write file '%s'\n", datafile);
+    }
+    return result;
+}
+
+// Export patient data from a Patient array to file (returns # of records written, -1 on error)
+int exportPatients(const char* datafile, const struct Patient patients[], int max)
+{
+    int i, description, count = 0;
+    char tempfile[FILENAME_MAX];
+    FILE* fp = openExportFile(datafile, tempfile, FILENAME_MAX);
+    if (fp == NULL) return -1;
+    for (i = 0; i < max; i++) {
+        if (patients[i].patientNumber > 0) {
+            // Never write an empty contact type: the import can't tell it from a missing field
+            description = patients[i].phone.description;
+            if (description <= PHONE_NONE || description > PHONE_TBD) description = PHONE_TBD;
+            fprintf(fp, "%d|%s|%s|%s\n", patients[i].patientNumber, patients[i].name,
+                phoneDescription(description), patients[i].phone.number);
+            count++;
+        }
+    }
+    return commitExportFile(fp, tempfile, datafile) ? -1 : count;
+}
+
+// Export appointment data from an Appointment array to file (returns # of records written, -1 on error)
+int exportAppointments(const char* datafile, const struct Appointment appoints[], int max)
+{
+    int i, count = 0;
+    char tempfile[FILENAME_MAX];
+    FILE* fp = openExportFile(datafile, tempfile, FILENAME_MAX);
+    if (fp == NULL) return -1;
+    for (i = 0; i < max; i++) {
+        if (appoints[i].patientNumber > 0) {
+            fprintf(fp, "%d,%d,%d,%d,%d,%d", appoints[i].patientNumber,
+                appoints[i].date.year, appoints[i].date.month, appoints[i].date.day,
+                appoints[i].time.hour, appoints[i].time.min);
+            if (appointmentVisits(&appoints[i]) > 1) fprintf(fp, ",%d,%d",
+                appoints[i].repeatDays, appoints[i].repeatCount);
+            fputc('\n', fp);
+            count++;
+        }
+    }
+    return commitExportFile(fp, tempfile, datafile) ? -1 : count;
+}
+
+// Import per-weekday clinic hours from file (returns # of weekdays read, 0 keeps the current schedule)
+// Invalid lines are skipped with a warning
+int importSchedule(const char* datafile, struct Schedule* schedule)
+{
+    int count = 0, lineNumber = 0, offset, truncated, weekday, start, end, interval;
+    char line[RECORD_LINE_LEN];
+    FILE* fp;
+    fp = fopen(datafile, "r");
+    if (fp != NULL) {
+        while (readRecordLine(fp, line, RECORD_LINE_LEN, &truncated)) {
+            lineNumber++;
+            // An optional first line can name the fields (as shown in the README)
+            if (lineNumber == 1 && strncmp(line, "weekday", 7) == 0) continue;
+            offset = 0;
+            sscanf(line, "%d,%d,%d,%d%n", &weekday, &start, &end, &interval, &offset);
+            while (offset > 0 && (line[offset] == ' ' || line[offset] == '\t')) offset++;
+            if (truncated || offset == 0 || line[offset] != '\0' ||
+                weekday < 0 || weekday >= DAYS_PER_WEEK || start < 0 || end > 24 || start >= end ||
+                interval <= 0 || interval > (end - start) * 60) {
+                printf("WARNING: '%s' line %d is not a valid weekday schedule (skipped)\n", datafile, lineNumber);
+                continue;
+            }
+            // Weekdays missing from the file are closed
+            if (count == 0) {
+                for (int i = 0; i < DAYS_PER_WEEK; i++) setScheduleHours(schedule, i, 0, 0, 0);
+            }
+            setScheduleHours(schedule, weekday, start, end, interval);
+            count++;
+        }
+        fclose(fp);
+    }
+    return count;
+}
 
+// Import archived appointments from file into a new array (returns # of records read, -1 on error)
+// The caller must free() the returned array
+int importArchive(const char* datafile, struct Appointment** appoints)
+{
+    int count = 0, days = 0, delta, minutes, num, max;
+    FILE* fp;
+    *appoints = NULL;
+    max = countRecords(datafile);
+    if (max == 0) return 0;
+    *appoints = calloc(max, sizeof(struct Appointment));
+    fp = fopen(datafile, "r");
+    if (*appoints == NULL || fp == NULL) {
+        if (fp != NULL) fclose(fp);
+        free(*appoints);
+        *appoints = NULL;
+        return -1;
+    }
+    // Each line: days since the previous line's date, minutes past midnight, patient number
+    while (count < max && fscanf(fp, "%d,%d,%d", &delta, &minutes, &num) == 3) {
+        // Dates outside MIN_YEAR..MAX_YEAR mean the file is damaged: stop reading
+        if ((long long)days + delta < dateToDays(MIN_YEAR, 1, 1) ||
+            (long long)days + delta > dateToDays(MAX_YEAR, 12, 31)) {
+            printf("WARNING: '%s' line %d has an invalid date (rest of the archive ignored)\n", datafile, count + 1);
+            break;
+        }
+        days += delta;
+        daysToDate(days, &(*appoints)[count].date.year, &(*appoints)[count].date.month,
+            &(*appoints)[count].date.day);
+        (*appoints)[count].time.hour = minutes / 60;
+        (*appoints)[count].time.min = minutes % 60;
+        (*appoints)[count].patientNumber = num;
+        count++;
+    }
+    fclose(fp);
+    return count;
+}
 
+// Export appointments sorted by date and time to an archive file (returns # of records written, -1 on error)
+int exportArchive(const char* datafile, const struct Appointment appoints[], int count)
+{
+    int i, days, prev = 0;
+    char tempfile[FILENAME_MAX];
+    FILE* fp = openExportFile(datafile, tempfile, FILENAME_MAX);
+    if (fp == NULL) return -1;
+    for (i = 0; i < count; i++) {
+        days = dateToDays(appoints[i].date.year, appoints[i].date.month, appoints[i].date.day);
+        fprintf(fp, "%d,%d,%d\n", days - prev,
+            appoints[i].time.hour * 60 + appoints[i].time.min, appoints[i].patientNumber);
+        prev = days;
+    }
+    return commitExportFile(fp, tempfile, datafile) ? -1 : count;
+}
\ No newline at end of file
@@ -10,16 +10,67 @@
 #define PHONE_DESC_LEN 4
 #define PHONE_LEN 10
 
+// Clinic data file names (inside the clinic data directory)
+#define PATIENT_FILE "patientData.txt"
+#define APPOINTMENT_FILE "appointmentData.txt"
+
+// Default clinic hours (used for every weekday when there is no SCHEDULE_FILE)
 #define START_TIME 10
 #define END_TIME 14
 #define INTERVAL 30
 
+#define DAYS_PER_WEEK 7
+#define MINUTES_PER_DAY 1440
+
+// Optional per-weekday clinic hours ("weekday,startHour,endHour,interval" with 0 = Sunday)
+#define SCHEDULE_FILE "scheduleData.txt"
+
+// Recurring appointment series limits
+#define MAX_REPEAT_DAYS 365
+#define MAX_REPEAT_COUNT 520
+
+// Number of changes that can be undone
+#define UNDO_DEPTH 20
+
+// Change log record types
+#define CHANGE_PATIENT 1
+#define CHANGE_APPOINTMENT 2
+
+// Patient number Bloom filter bits per patient slot (rounded up to a power of two), smallest size
+// in bits, bits set per number and the share of the patient slots (1/n) whose numbers can be
+// removed before the filter is rebuilt
+#define PATIENT_FILTER_BITS_PER_ENTRY 10
+#define PATIENT_FILTER_MIN_BITS 64
+#define PATIENT_FILTER_HASHES 3
+#define PATIENT_FILTER_STALE 4
+
+// Longest data file line read on import (the rest of a longer line is discarded)
+#define RECORD_LINE_LEN 128
+
+// Buffer size used when exporting data files
+#define EXPORT_BUFFER_SIZE 65536
+
+// Utilisation summary output file
+#define SUMMARY_FILE "appointmentSummary.csv"
+
+// Archive file for past appointments
+#define ARCHIVE_FILE "appointmentArchive.txt"
+
+// Phone contact types (stored in Phone.description)
+enum PhoneDescription {
+    PHONE_NONE,
+    PHONE_CELL,
+    PHONE_HOME,
+    PHONE_WORK,
+    PHONE_TBD
+};
+
 //////////////////////////////////////
 // Structures
 //////////////////////////////////////
 
 struct Phone {
-    char description[PHONE_DESC_LEN + 1];
+    unsigned char description;
     char number[PHONE_LEN + 1];
 };
 
@@ -44,6 +95,54 @@ struct Appointment {
     int patientNumber;
     struct Date date;
     struct Time time;
+    int repeatDays;     // days between visits of a recurring series (0 = single visit)
+    int repeatCount;    // number of visits in a recurring series
+};
+
+// Opening hours of one weekday (closed when interval is 0)
+struct ClinicHours {
+    int start;
+    int end;
+    int interval;
+};
+
+// Clinic schedule precomputed into slot tables
+struct Schedule {
+    int openDays;                                       // bit n set: open on weekday n
+    struct ClinicHours hours[DAYS_PER_WEEK];
+    int slotCount[DAYS_PER_WEEK];                       // bookable slots per weekday
+    short slotOf[DAYS_PER_WEEK][MINUTES_PER_DAY];       // minute of day -> slot index (-1 = not bookable)
+};
+
+// A single record change: the record before and after the change
+struct Change {
+    int type;       // CHANGE_PATIENT | CHANGE_APPOINTMENT
+    int index;      // array index of the changed record
+    struct Patient patient[2];
+    struct Appointment appoint[2];
+};
+
+// Bounded undo/redo history (oldest change first)
+struct ChangeLog {
+    struct Change changes[UNDO_DEPTH];
+    int count;      // # of changes recorded
+    int undone;     // # of the most recent changes that are currently undone
+};
+
+// Bloom filter over patient numbers: rejects most unknown numbers without a table scan
+struct PatientFilter {
+    unsigned char* bits;
+    unsigned int size;      // # of bits (power of two)
+    int stale;              // # of patient numbers removed since the last rebuild
+};
+
+// Data file paths of one clinic
+struct ClinicFiles {
+    char patients[FILENAME_MAX];
+    char appointments[FILENAME_MAX];
+    char schedule[FILENAME_MAX];
+    char summary[FILENAME_MAX];
+    char archive[FILENAME_MAX];
 };
 
 struct ClinicData {
@@ -51,6 +150,11 @@ struct ClinicData {
     int maxPatient;
     struct Appointment* appointments;
     int maxAppointments;
+    struct ChangeLog* log;
+    struct PatientFilter* filter;
+    struct Schedule* schedule;
+    const struct ClinicFiles* files;
+    int importComplete;     // every data file record was loaded (safe to export over the files)
 };
 
 //////////////////////////////////////
@@ -79,7 +183,7 @@ void displayScheduleData(const struct Patient* patient,
 void menuMain(struct ClinicData* data);
 
 // Menu: Patient Management
-void menuPatient(struct Patient patient[], int max);
+void menuPatient(struct ClinicData* data);
 
 // Menu: Patient edit
 void menuPatientEdit(struct Patient* patient);
@@ -87,6 +191,12 @@ void menuPatientEdit(struct Patient* patient);
 // Menu: Appointment Management
 void menuAppointment(struct ClinicData* data);
 
+// Undo the most recent change to the patient or appointment records
+void undoChange(struct ClinicData* data);
+
+// Redo the most recently undone change
+void redoChange(struct ClinicData* data);
+
 // Display's all patient data in the FMT_FORM | FMT_TABLE format
 void displayAllPatients(const struct Patient patient[], int max, int fmt);
 
@@ -94,13 +204,13 @@ void displayAllPatients(const struct Patient patient[], int max, int fmt);
 void searchPatientData(const struct Patient patient[], int max);
 
 // Add a new patient record to the patient array
-void addPatient(struct Patient patient[], int max);
+void addPatient(struct ClinicData* data);
 
 // Edit a patient record from the patient array
-void editPatient(struct Patient patient[], int max);
+void editPatient(struct ClinicData* data);
 
 // Remove a patient record from the patient array
-void removePatient(struct Patient patient[], int max);
+void removePatient(struct ClinicData* data);
 
 // View ALL scheduled appointments
 void viewAllAppointments(struct ClinicData* data);
@@ -108,11 +218,19 @@ void viewAllAppointments(struct ClinicData* data);
 // View appointment schedule for the user input date
 void viewAppointmentSchedule(struct ClinicData* data);
 
+// View per-day utilisation, busiest hours and per-patient visit counts
+// (also written to SUMMARY_FILE)
+void viewAppointmentSummary(struct ClinicData* data);
+
+// Move appointments before a user input date from the appointment array to ARCHIVE_FILE
+// (the patient and appointment files are saved at the same time)
+void archiveAppointments(struct ClinicData* data);
+
 // Add an appointment record to the appointment array
-void addAppointment(struct Appointment* app, int maxAppointments, struct Patient* pt, int maxPatients);
+void addAppointment(struct ClinicData* data);
 
 // Remove an appointment record from the appointment array
-void removeAppointment(struct Appointment* app, int maxAppointments, struct Patient* pt, int maxPatients);
+void removeAppointment(struct ClinicData* data);
 
 //////////////////////////////////////
 // UTILITY FUNCTIONS
@@ -131,13 +249,98 @@ int nextPatientNumber(const struct Patient patient[], int max);
 int findPatientIndexByPatientNum(int patientNumber,
     const struct Patient patient[], int max);
 
-//Retrieves the index of the next available appointment,
+// Allocate a patient number filter sized for max patients (returns 0 on success, -1 on error)
+int initPatientFilter(struct PatientFilter* filter, int max);
+
+// Free the memory of a patient number filter
+void freePatientFilter(struct PatientFilter* filter);
+
+// Rebuild the patient number filter from the patient array
+void buildPatientFilter(struct PatientFilter* filter, const struct Patient patient[], int max);
+
+// Add a patient number to the patient number filter
+void addPatientFilter(struct PatientFilter* filter, int patientNumber);
+
+// Note that a patient number was removed from the clinic's patient array: the filter can't
+// drop a number, so it is rebuilt once too many removed numbers are still set in it
+void notePatientRemoved(struct ClinicData* data);
+
+// Check the patient number filter (returns 0 if the patient number is definitely not in use)
+int mayHavePatient(const struct PatientFilter* filter, int patientNumber);
+
+// Find the patient array index by patient number using the clinic's filter (returns -1 if not found)
+int findPatient(const struct ClinicData* data, int patientNumber);
+
+// Set every weekday to the default clinic hours (START_TIME, END_TIME, INTERVAL)
+void initSchedule(struct Schedule* schedule);
+
+// Set the clinic hours of one weekday and rebuild its slot table (interval 0 closes the day)
+void setScheduleHours(struct Schedule* schedule, int weekday, int start, int end, int interval);
+
+// Get the slot index of a date and time (returns -1 if it isn't a bookable slot)
+int scheduleSlot(const struct Schedule* schedule, const struct Date* date, const struct Time* time);
+
+// Check that every visit of an appointment is on a bookable slot
+int appointmentInSchedule(const struct Schedule* schedule, const struct Appointment* appoint);
+
+//Retrieves the index of the next available appointment (returns -1 if the array is full)
 int nextAppAvailable(struct Appointment* app, int max);
 
+// Get the number of visits of an appointment (1 unless it is a recurring series)
+int appointmentVisits(const struct Appointment* appoint);
+
+// Check if any visit of an appointment is on the date and time of an archived visit
+// (returns 1 if so or if the archive can't be read, 0 otherwise)
+int archiveConflicts(const struct ClinicData* data, const struct Appointment* appoint);
+
+// Get the n-th visit (from 0) of an appointment as a single appointment
+void appointmentVisit(const struct Appointment* appoint, int n, struct Appointment* visit);
+
+// Check if an appointment (single or recurring) has a visit on the date
+int appointmentOccurs(const struct Appointment* appoint, const struct Date* date);
+
+// Check if any visit of an appointment clashes with a visit in the appointment array
+int appointmentConflicts(const struct Appointment* appoint, const struct Appointment app[], int max);
+
+// Expand all appointments into single visits (returns # of visits, -1 if out of memory)
+// The caller must free() the returned array
+int expandAppointments(const struct Appointment app[], int max, struct Appointment** visits);
+
+// Record a change to a patient record (before: the record as it was before the change)
+void recordPatientChange(struct ClinicData* data, int index, const struct Patient* before);
+
+// Record a change to an appointment record (before: the record as it was before the change)
+void recordAppointmentChange(struct ClinicData* data, int index, const struct Appointment* before);
+
+// Check the loaded records for duplicate patients, invalid appointments, appointments
+// of missing patients and double-booked slots (returns # of problems found)
+// With repair, offending records are removed (the first duplicate patient and, for a
+// double-booked slot, the record with the most visits are kept),
+// otherwise they are only reported
+int verifyClinicData(struct ClinicData* data, int repair);
+
+// Save the patient and appointment arrays to the clinic's data files (returns 0 on success, -1 on error)
+int saveClinicData(const struct ClinicData* data);
+
+// Get the display text for a phone description ("CELL", "HOME", "WORK", "TBD")
+const char* phoneDescription(int description);
+
+// Convert phone description text to its PhoneDescription value (PHONE_NONE if unknown)
+int parsePhoneDescription(const char string[]);
+
+// Chronological key for a date (its day number)
+int dateKey(const struct Date* date);
+
+// Chronological key for an appointment date and time (minutes since day number 0)
+long long appointmentKey(const struct Appointment* appoint);
+
 //////////////////////////////////////
 // USER INPUT FUNCTIONS
 //////////////////////////////////////
 
+// Get user input for a patient name ('|' separates the data file fields, so it is rejected)
+void inputPatientName(char name[]);
+
 // Get user input for a new patient record
 void inputPatient(struct Patient* patient);
 
@@ -151,10 +354,34 @@ void sortAppointment(struct Appointment* appoints, int max);
 // FILE FUNCTIONS
 //////////////////////////////////////
 
+// Set the data file paths of a clinic kept in a directory ("" or NULL = current directory)
+// (returns 0 on success, -1 if a path is too long)
+int setClinicFiles(struct ClinicFiles* files, const char* directory);
+
+// Count the records (non-empty lines) in a data file (returns 0 if the file can't be opened)
+int countRecords(const char* datafile);
+
 // Import patient data from file into a Patient array (returns # of records read)
 int importPatients(const char* datafile, struct Patient patients[], int max);
 
 // Import appointment data from file into an Appointment array (returns # of records read)
 int importAppointments(const char* datafile, struct Appointment appoints[], int max);
 
+// Export patient data from a Patient array to file (returns # of records written, -1 on error)
+int exportPatients(const char* datafile, const struct Patient patients[], int max);
+
+// Export appointment data from an Appointment array to file (returns # of records written, -1 on error)
+int exportAppointments(const char* datafile, const struct Appointment appoints[], int max);
+
+// Import per-weekday clinic hours from file (returns # of weekdays read, 0 keeps the current schedule)
+// Invalid lines are skipped with a warning
+int importSchedule(const char* datafile, struct Schedule* schedule);
+
+// Import archived appointments from file into a new array (returns # of records read, -1 on error)
+// The caller must free() the returned array
+int importArchive(const char* datafile, struct Appointment** appoints);
+
+// Export appointments sorted by date and time to an archive file (returns # of records written, -1 on error)
+int exportArchive(const char* datafile, const struct Appointment appoints[], int count);
+
 #endif // !CLINIC_H
\ No newline at end of file
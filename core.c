@@ -1,17 +1,86 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include "core.h"
 
+// Years covered by the precomputed calendar tables (other years are computed)
+#define CAL_FIRST_YEAR 1900
+#define CAL_LAST_YEAR 2299
+#define CAL_YEARS (CAL_LAST_YEAR - CAL_FIRST_YEAR + 1)
+
+// Days per month for normal [0] and leap [1] years
+static const unsigned char monthDays[2][13] = {
+    { 0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 },
+    { 0, 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 }
+};
+
+// Calendar tables, filled by initCalendar() on first use
+static int calendarReady = 0;
+static int yearStart[CAL_YEARS + 1];            // day number of January 1st
+static short monthStart[2][13];                 // day of year of the 1st of each month
+static unsigned char monthOfDay[2][366];        // day of year -> month
+
+// Longest input line accepted (longer lines are rejected, not truncated)
+#define INPUT_LINE_LEN 256
+
+// Where to jump when the input ends (set by setInputEnd)
+static jmp_buf* inputEnd = NULL;
+
+// Read one line of input without the newline (returns its length, or size if it didn't fit)
+// At the end of input it jumps to the setInputEnd() target instead of returning
+static int readLine(char line[], int size)
+{
+    int len;
+    if (fgets(line, size, stdin) == NULL) {
+        printf("\nEnd of input reached.\n");
+        if (inputEnd != NULL) longjmp(*inputEnd, 1);
+        exit(1);
+    }
+    len = strlen(line);
+    if (len > 0 && line[len - 1] == '\n') line[--len] = '\0';
+    else if (len == size - 1) {
+        clearInputBuffer();
+        len = size;
+    }
+    return len;
+}
+
+// Parse a whole line as an int (returns 1 on success, 0 if it isn't a whole number in int range)
+static int parseInt(const char line[], int* num)
+{
+    long long value = 0;
+    int i = 0, negative = 0, digits = 0;
+    while (line[i] == ' ' || line[i] == '\t') i++;
+    if (line[i] == '-' || line[i] == '+') negative = line[i++] == '-';
+    while (line[i] >= '0' && line[i] <= '9' && value <= INT_MAX) {
+        value = value * 10 + (line[i++] - '0');
+        digits++;
+    }
+    if (negative) value = -value;
+    if (digits == 0 || line[i] != '\0' || value > INT_MAX || value < INT_MIN) return 0;
+    *num = (int)value;
+    return 1;
+}
+
 //////////////////////////////////////
 // USER INTERFACE FUNCTIONS
 //////////////////////////////////////
 
+// Set where the input functions jump (longjmp(*target, 1)) when the input ends,
+// so the caller can finish up (NULL = the program exits)
+void setInputEnd(jmp_buf* target) {
+    inputEnd = target;
+}
+
 // Clear the standard input buffer
 void clearInputBuffer(void) {
-    while (getchar() != '\n') {
-    }
+    int ch;
+    do {
+        ch = getchar();
+    } while (ch != '\n' && ch != EOF);
 }
 
 // Wait for user to input the "enter" key to continue
@@ -27,15 +96,12 @@ void suspend(void) {
 
 // validates if the user input is an integer and returns it.
 int inputInt(void) {
-    int num;
-    char ch;
+    int num, valid;
+    char line[INPUT_LINE_LEN];
     do {
-        scanf("%d%c", &num, &ch);
-        if (ch != '\n') {
-            clearInputBuffer();
-            printf("Error! Input a whole number: ");
-        }
-    } while (ch != '\n');
+        valid = readLine(line, INPUT_LINE_LEN) < INPUT_LINE_LEN && parseInt(line, &num);
+        if (!valid) printf("Error! Input a whole number: ");
+    } while (!valid);
     return num;
 }
 
@@ -62,16 +128,18 @@ int inputIntRange(int low, int high) {
 
 // validate the entered character matches any of the characters in the received C string argument.
 char inputCharOption(const char string[]) {
-    char ch, ch1;
-    int found = 0;
+    char line[INPUT_LINE_LEN];
+    char ch = '\0';
+    int i, len, found = 0;
     do {
-        scanf(" %c%c", &ch, &ch1);
-        if (ch1 != '\n') {
-            clearInputBuffer();
-            printf("ERROR: Character must be one of [%s]: ", string);
+        len = readLine(line, INPUT_LINE_LEN);
+        for (i = 0; i < len && (line[i] == ' ' || line[i] == '\t'); i++) {
+        }
+        if (i < len) {
+            ch = line[i];
+            if (i + 1 != len || !strchr(string, ch)) printf("ERROR: Character must be one of [%s]: ", string);
+            else found = 1;
         }
-        else if (!strchr(string, ch)) printf("ERROR: Character must be one of [%s]: ", string);
-        else found = 1;
     } while (!found);
     return ch;
 }
@@ -79,18 +147,17 @@ char inputCharOption(const char string[]) {
 // validates the entered number of characters is within the specified range.
 void inputCString(char string[], int low, int high)
 {
+    char line[INPUT_LINE_LEN];
     int count;
     do {
-        scanf("%[^\n]", string);
-        count = strlen(string);
+        count = readLine(line, INPUT_LINE_LEN);
         if (count<low || count>high) {
             if (low == high) printf("ERROR: String length must be exactly %d chars: ", low);
             else if (count > high) printf("ERROR: String length must be no more than %d chars: ", high);
             else printf("ERROR: String length must be between %d and %d chars: ", low, high);
         }
-        clearInputBuffer();
     } while (count<low || count>high);
-
+    memcpy(string, line, count + 1);
 }
 
 // display an array of 10-character digits as a formatted phone number.
@@ -113,31 +180,107 @@ void displayFormattedPhone(const char string[])
 
 //validates the date based on the Gregorian calendar
 void isTimeValid(int* year, int* month, int* day) {
-    int lastDay = 30;
+    int lastDay;
     printf("Year        : ");
-    *year = inputIntPositive();
+    *year = inputIntRange(MIN_YEAR, MAX_YEAR);
     printf("Month (1-12): ");
     *month = inputIntRange(1, 12);
-    if (*month == 4 || *month == 6 || *month == 9 || *month == 11) lastDay = 30;
-    else if (*month == 2) {
-        if (*year % 4 == 0 && (*year % 100 != 0 || *year % 400 == 0)) lastDay = 29;
-        else lastDay = 28;
-    }
-    else lastDay = 31;
+    lastDay = daysInMonth(*year, *month);
     printf("Day (1-%d)  : ", lastDay);
     *day = inputIntRange(1, lastDay);
 }
 
+// check for a leap year in the Gregorian calendar
+int isLeapYear(int year) {
+    return year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+}
+
+// get the number of days in a month of the Gregorian calendar (0 if the month is invalid)
+int daysInMonth(int year, int month) {
+    return month >= 1 && month <= 12 ? monthDays[isLeapYear(year)][month] : 0;
+}
+
+// day number by formula (used to build the tables and for years outside them)
+static int calcDateToDays(int year, int month, int day) {
+    // count from March so the leap day is the last day of the year
+    if (month <= 2) {
+        year--;
+        month += 12;
+    }
+    return year * 365 + year / 4 - year / 100 + year / 400 + (153 * (month - 3) + 2) / 5 + day - 1;
+}
+
+// fill the calendar tables on first use
+static void initCalendar(void) {
+    int i, leap, month, doy;
+    for (i = 0; i <= CAL_YEARS; i++) {
+        yearStart[i] = calcDateToDays(CAL_FIRST_YEAR + i, 1, 1);
+    }
+    for (leap = 0; leap < 2; leap++) {
+        for (month = 1, doy = 0; month <= 12; month++) {
+            monthStart[leap][month] = doy;
+            for (i = 0; i < monthDays[leap][month]; i++) monthOfDay[leap][doy++] = month;
+        }
+    }
+    calendarReady = 1;
+}
+
+// convert a date to a day number (consecutive dates have consecutive numbers)
+int dateToDays(int year, int month, int day) {
+    int days;
+    if (year < CAL_FIRST_YEAR || year > CAL_LAST_YEAR || month < 1 || month > 12) {
+        days = calcDateToDays(year, month, day);
+    }
+    else {
+        if (!calendarReady) initCalendar();
+        days = yearStart[year - CAL_FIRST_YEAR] + monthStart[isLeapYear(year)][month] + day - 1;
+    }
+    return days;
+}
+
+// convert a day number back to a date
+void daysToDate(int days, int* year, int* month, int* day) {
+    int i, leap, doy;
+    if (!calendarReady) initCalendar();
+    if (days >= yearStart[0] && days < yearStart[CAL_YEARS]) {
+        // 146097 days per 400 years: the estimate is at most one year off
+        i = (int)((long long)(days - yearStart[0]) * 400 / 146097);
+        if (i > 0 && days < yearStart[i]) i--;
+        else if (i < CAL_YEARS - 1 && days >= yearStart[i + 1]) i++;
+        *year = CAL_FIRST_YEAR + i;
+        leap = isLeapYear(*year);
+        doy = days - yearStart[i];
+        *month = monthOfDay[leap][doy];
+        *day = doy - monthStart[leap][*month] + 1;
+    }
+    else {
+        int era = days / 146097, doe = days % 146097;
+        int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        int mp = (5 * doy + 2) / 153;
+        *day = doy - (153 * mp + 2) / 5 + 1;
+        *month = mp < 10 ? mp + 3 : mp - 9;
+        *year = era * 400 + yoe + (*month <= 2);
+    }
+}
+
+// get the day of the week of a date (0 = Sunday ... 6 = Saturday)
+int dayOfWeek(int year, int month, int day) {
+    // day number 0 (March 1st of year 0) was a Wednesday
+    return ((dateToDays(year, month, day) + 3) % 7 + 7) % 7;
+}
+
 // validates the entered number of digits
 void inputCStringDigit(char string[], int num )
 {
-    int count;
+    char line[INPUT_LINE_LEN];
+    int i, count;
     do {
-        scanf("%[^\n]", string);
-        count = strlen(string);
-        if (count != num) printf("Invalid %d-digit number! Number: ", num);
-        clearInputBuffer();
-    } while (count != num);
-
+        count = readLine(line, INPUT_LINE_LEN);
+        for (i = 0; i < count && line[i] >= '0' && line[i] <= '9'; i++) {
+        }
+        if (count != num || i != count) printf("Invalid %d-digit number! Number: ", num);
+    } while (count != num || i != count);
+    memcpy(string, line, count + 1);
 }
 
@@ -1,10 +1,16 @@
 #ifndef CORE_H
 #define CORE_H
 
+#include <setjmp.h>
+
 //////////////////////////////////////
 // USER INTERFACE FUNCTIONS
 //////////////////////////////////////
 
+// Set where the input functions jump (longjmp(*target, 1)) when the input ends,
+// so the caller can finish up (NULL = the program exits)
+void setInputEnd(jmp_buf* target);
+
 // Clear the standard input buffer
 void clearInputBuffer(void);
 
@@ -33,9 +39,28 @@ void inputCString(char string[], int low, int high);
 // display an array of 10-character digits as a formatted phone number.
 void displayFormattedPhone(const char string[]);
 
+// Range of years accepted for dates (keeps day numbers and appointment keys in range)
+#define MIN_YEAR 1
+#define MAX_YEAR 9999
+
 //validates the date based on the Gregorian calendar
 void isTimeValid(int* year, int* month, int* day);
 
+// check for a leap year in the Gregorian calendar
+int isLeapYear(int year);
+
+// get the number of days in a month of the Gregorian calendar (0 if the month is invalid)
+int daysInMonth(int year, int month);
+
+// convert a date to a day number (consecutive dates have consecutive numbers)
+int dateToDays(int year, int month, int day);
+
+// convert a day number back to a date
+void daysToDate(int days, int* year, int* month, int* day);
+
+// get the day of the week of a date (0 = Sunday ... 6 = Saturday)
+int dayOfWeek(int year, int month, int day);
+
 // validates the entered number of digits
 void inputCStringDigit(char string[], int num);
 
@@ -1,23 +1,81 @@
 #include <stdio.h>
+#include <stdlib.h>
 
+#include "core.h"
 #include "clinic.h"
 
+// Free slots allocated on top of the records found in the data files
 #define MAX_PETS 20
 #define MAX_APPOINTMENTS 50
 
-int main(void)
+// Usage: healthcarepro [clinic data directory]
+// Each clinic keeps its own data files in its own directory (default: current directory)
+int main(int argc, char* argv[])
 {
-    struct Patient pets[MAX_PETS] = { {0} };
-    struct Appointment appoints[MAX_APPOINTMENTS] = { {0} };
-    struct ClinicData data = { pets, MAX_PETS, appoints, MAX_APPOINTMENTS };
+    static struct ClinicFiles files;
+    static jmp_buf inputEnd;
+    if (setClinicFiles(&files, argc > 1 ? argv[1] : NULL)) {
+        printf("ERROR: Clinic data directory path is too long!\n");
+        return 1;
+    }
 
-    int patientCount = importPatients("patientData.txt", pets, MAX_PETS);
-    int appointmentCount = importAppointments("appointmentData.txt", appoints, MAX_APPOINTMENTS);
+    int maxPatients = countRecords(files.patients) + MAX_PETS;
+    int maxAppointments = countRecords(files.appointments) + MAX_APPOINTMENTS;
+    struct Patient* pets = calloc(maxPatients, sizeof(struct Patient));
+    struct Appointment* appoints = calloc(maxAppointments, sizeof(struct Appointment));
+    struct ChangeLog log = { 0 };
+    struct PatientFilter filter = { 0 };
+    struct Schedule schedule = { 0 };
+    struct ClinicData data = { pets, maxPatients, appoints, maxAppointments, &log, &filter, &schedule, &files, 0 };
+
+    if (pets == NULL || appoints == NULL || initPatientFilter(&filter, maxPatients)) {
+        printf("ERROR: Not enough memory to load clinic data!\n");
+        freePatientFilter(&filter);
+        free(pets);
+        free(appoints);
+        return 1;
+    }
+
+    int patientCount = importPatients(files.patients, pets, maxPatients);
+    int appointmentCount = importAppointments(files.appointments, appoints, maxAppointments);
+    data.importComplete = patientCount == countRecords(files.patients)
+        && appointmentCount == countRecords(files.appointments);
+    buildPatientFilter(&filter, pets, maxPatients);
+    initSchedule(&schedule);
+    importSchedule(files.schedule, &schedule);
 
     printf("Imported %d patient records...\n", patientCount);
     printf("Imported %d appointment records...\n\n", appointmentCount);
+    if (!data.importComplete)
+        printf("WARNING: Some data file records could not be read; changes will NOT be saved.\n\n");
+
+    // At the end of input the session stops here and the data is saved as on exit
+    // (an unfinished operation is dropped: records only change once their input is complete)
+    if (setjmp(inputEnd) == 0) {
+        setInputEnd(&inputEnd);
+
+        // Report problems first: repairing removes records, so it needs the user's confirmation
+        int problems = verifyClinicData(&data, 0);
+        if (problems > 0 && data.importComplete) {
+            printf("\nFound %d data problem(s). Remove the problem records? (y|n): ", problems);
+            if (inputCharOption("yn") == 'y') {
+                problems = verifyClinicData(&data, 1);
+                buildPatientFilter(&filter, pets, maxPatients);
+                printf("Repaired %d data problem(s)...\n\n", problems);
+            }
+            else printf("Records kept as imported.\n\n");
+        }
+        else if (problems > 0) printf("Found %d data problem(s)...\n\n", problems);
+
+        menuMain(&data);
+    }
+    setInputEnd(NULL);
+
+    if (data.importComplete) saveClinicData(&data);
+    else printf("Data files were not fully imported: nothing exported.\n");
 
-    menuMain(&data);
-    
+    freePatientFilter(&filter);
+    free(pets);
+    free(appoints);
     return 0;
 }
\ No newline at end of file